@@ -1,24 +1,162 @@
 #include "application.hpp"
 
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
 Application::Application():
     m_glfw(glfw::init()),
     m_window(createVulkanWindow(1280, 720, "vulkan_triangle")),
-    m_graphics(m_window)
+    m_graphics(m_window, getInitialSampleCount(),
+               std::getenv("VULKAN_TRIANGLE_CAPTURE") != nullptr || std::getenv("VULKAN_TRIANGLE_GOLDEN") != nullptr,
+               std::getenv("VULKAN_TRIANGLE_RENDER_PASS") != nullptr),
+    m_mustResize(false),
+    m_mustRender(true),
+    m_requestedSamples(0),
+    m_tracePath(std::getenv("VULKAN_TRIANGLE_TRACE")),
+    m_capturePath(std::getenv("VULKAN_TRIANGLE_CAPTURE")),
+    m_goldenPath(std::getenv("VULKAN_TRIANGLE_GOLDEN"))
 {
+    // Record a Chrome trace if a path for it was given
+    m_graphics.profiler().setTraceEnabled(m_tracePath != nullptr);
+
+    // Capture every rendered frame into a directory and/or the first frame for comparison with a golden image
+    if (m_capturePath != nullptr) {
+        auto format = std::getenv("VULKAN_TRIANGLE_CAPTURE_FORMAT");
+        auto isRaw = format != nullptr && std::string(format) == "raw";
+        m_graphics.capture().startContinuous(m_capturePath, isRaw ? CaptureFormat::eRaw : CaptureFormat::ePng);
+    }
+    if (m_goldenPath != nullptr)
+        m_graphics.capture().requestSnapshot();
+
     m_window.framebufferSizeEvent.setCallback([this](glfw::Window &_window, int _width, int _height) {
         m_mustResize = true;
     });
+
+    // Redraw when the window system lost the window's contents, e.g. after it was uncovered or restored without a
+    // resize on a non-compositing desktop
+    m_window.windowRefreshEvent.setCallback([this](glfw::Window &_window) {
+        m_mustRender = true;
+    });
+
+    // Select the MSAA sample count at runtime with the 1, 2, 4 and 8 keys
+    m_window.keyEvent.setCallback([this](glfw::Window &_window, glfw::KeyCode key, int _scancode,
+                                         glfw::KeyState state, glfw::ModifierKeyBit _modifiers) {
+        if (state != glfw::KeyState::Press)
+            return;
+        switch (key) {
+            case glfw::KeyCode::One:   m_requestedSamples = 1; break;
+            case glfw::KeyCode::Two:   m_requestedSamples = 2; break;
+            case glfw::KeyCode::Four:  m_requestedSamples = 4; break;
+            case glfw::KeyCode::Eight: m_requestedSamples = 8; break;
+            default: break;
+        }
+    });
 }
 
-void Application::runUntilClose() {
+int Application::runUntilClose() {
+    auto &profiler = m_graphics.profiler();
+    auto exitCode = 0;
     while (!m_window.shouldClose()) {
-        glfw::pollEvents();
+        waitForEvents();
+
+        // Finish once the frame for the golden-image comparison has been captured
+        m_graphics.pollCaptures();
+        auto snapshot = CapturedImage();
+        if (m_goldenPath != nullptr && m_graphics.capture().takeSnapshot(snapshot)) {
+            exitCode = compareWithGolden(snapshot);
+            break;
+        }
+
+        // Nothing can be presented while minimized, a pending resize is applied once the window is restored
+        if (isMinimized()) {
+            profiler.addIdleWakeup();
+            continue;
+        }
+
+        // The scene is static, so the presented image stays valid until something was changed
+        if (!m_mustRender && !m_mustResize && m_requestedSamples == 0) {
+            profiler.addIdleWakeup();
+            continue;
+        }
+        ProfileScope frameScope(profiler, "frame");
+
+        // Apply changes to the swapchain and attachments, each of them requires a new frame
         if (m_mustResize) {
+            ProfileScope scope(profiler, "handleResize");
             m_graphics.handleResize();
             m_mustResize = false;
         }
-        m_graphics.renderFrame();
+        if (m_requestedSamples != 0) {
+            ProfileScope scope(profiler, "setSampleCount");
+            m_graphics.setSampleCount(m_requestedSamples);
+            m_requestedSamples = 0;
+        }
+        {
+            ProfileScope scope(profiler, "renderFrame");
+            m_graphics.renderFrame();
+        }
+
+        // Continuous capture has to record every frame, so it keeps the loop rendering at full frame rate
+        m_mustRender = m_graphics.capture().isContinuous();
     }
+
+    // Optionally export the trace and print the rolling statistics
+    if (m_tracePath != nullptr) {
+        std::ofstream stream(m_tracePath);
+        if (!stream.is_open())
+            throw std::runtime_error("Unable to open trace file");
+        profiler.writeChromeTrace(stream);
+        profiler.writeStatisticsTable(std::cout);
+    }
+    if (m_capturePath != nullptr)
+        std::cout << "capture: " << m_graphics.capture().getDroppedFrames() << " frames dropped" << std::endl;
+    return exitCode;
+}
+
+void Application::waitForEvents() {
+    // Block until the window is restored while minimized, blocking waits are not profiled so that idle time does not
+    // end up in the statistics
+    if (isMinimized()) {
+        glfw::waitEvents();
+        return;
+    }
+
+    // Only poll if there is work left, otherwise sleep until an event arrives or the idle timeout has passed
+    if (m_mustRender || m_mustResize || m_requestedSamples != 0) {
+        ProfileScope scope(m_graphics.profiler(), "pollEvents");
+        glfw::pollEvents();
+    } else {
+        glfw::waitEvents(k_idleTimeout);
+    }
+}
+
+bool Application::isMinimized() {
+    // A minimized window has an empty framebuffer, for which no swapchain can be created
+    auto extentTuple = m_window.getFramebufferSize();
+    return std::get<0>(extentTuple) == 0 || std::get<1>(extentTuple) == 0;
+}
+
+int Application::compareWithGolden(const CapturedImage &image) {
+    // Record the golden image if there is none yet
+    auto reference = CapturedImage();
+    if (!FrameCapture::readRaw(m_goldenPath, reference)) {
+        FrameCapture::writeRaw(m_goldenPath, image);
+        std::cout << "golden: recorded " << image.width << "x" << image.height << " image" << std::endl;
+        return 0;
+    }
+
+    // Fail if the extent differs or any pixel differs by more than the tolerance
+    auto difference = FrameCapture::compare(image, reference, k_goldenTolerance);
+    if (!difference.sizeMatches) {
+        std::cout << "golden: size mismatch, captured " << image.width << "x" << image.height << " but expected "
+                  << reference.width << "x" << reference.height << std::endl;
+        return 1;
+    }
+    std::cout << "golden: " << difference.differentPixels << " pixels differ, max channel difference "
+              << difference.maxChannelDifference << std::endl;
+    return difference.differentPixels == 0 ? 0 : 1;
 }
 
 glfw::Window Application::createVulkanWindow(int width, int height, const char *title) {
@@ -28,3 +166,19 @@ glfw::Window Application::createVulkanWindow(int width, int height, const char *
     hints.apply();
     return glfw::Window(width, height, title);
 }
+
+uint32_t Application::getInitialSampleCount() {
+    // Use 4x MSAA unless another sample count was given, it is clamped to the device's limits later
+    auto samples = std::getenv("VULKAN_TRIANGLE_SAMPLES");
+    if (samples == nullptr)
+        return 4;
+
+    // Reject anything but a decimal number from 1 to 64 instead of silently rendering without MSAA
+    char *end;
+    auto value = std::strtoul(samples, &end, 10);
+    if (end == samples || *end != '\0' || value == 0 || value > 64) {
+        std::cerr << "VULKAN_TRIANGLE_SAMPLES: invalid sample count '" << samples << "', using 4" << std::endl;
+        return 4;
+    }
+    return static_cast<uint32_t>(value);
+}
@@ -9,12 +9,24 @@ class Application {
 public:
     Application();
 
-    void runUntilClose();
+    int runUntilClose();
 private:
     glfw::GlfwLibrary m_glfw;
     glfw::Window      m_window;
     Graphics          m_graphics;
     bool              m_mustResize;
+    bool              m_mustRender;
+    uint32_t          m_requestedSamples;
+    const char       *m_tracePath;
+    const char       *m_capturePath;
+    const char       *m_goldenPath;
 
+    static constexpr double   k_idleTimeout = 0.5;
+    static constexpr uint32_t k_goldenTolerance = 2;
+
+    void waitForEvents();
+    bool isMinimized();
+    int compareWithGolden(const CapturedImage &image);
     static glfw::Window createVulkanWindow(int width, int height, const char *title);
+    static uint32_t getInitialSampleCount();
 };
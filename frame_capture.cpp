@@ -0,0 +1,446 @@
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+FrameCapture::FrameCapture():
+    m_format(vk::Format::eUndefined),
+    m_coherent(false),
+    m_frameCounter(0),
+    m_droppedFrames(0),
+    m_snapshotRequested(false),
+    m_continuous(false),
+    m_captureFormat(CaptureFormat::ePng),
+    m_stopping(false),
+    m_snapshotReady(false)
+{
+}
+
+FrameCapture::~FrameCapture() {
+    // Let the encoder finish the queued frames before the buffers are destroyed
+    if (m_encoder.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        m_encoder.join();
+    }
+}
+
+void FrameCapture::create(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties,
+                          vk::Format format)
+{
+    // Only 8-bit RGBA and BGRA images can be converted without a format-specific encoder
+    switch (format) {
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Srgb:
+            break;
+        default:
+            throw std::runtime_error("Unable to capture swapchain images of this format");
+    }
+
+    m_device = device;
+    m_memoryProperties = memoryProperties;
+    m_format = format;
+    m_encoder = std::thread(&FrameCapture::runEncoder, this);
+}
+
+void FrameCapture::resize(vk::Extent2D extent) {
+    // Hand over the copies of the last frame and wait until the encoder no longer reads any buffer
+    collect();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() {
+            return std::all_of(m_slots.begin(), m_slots.end(), [](const ReadbackSlot &slot) {
+                return slot.state == SlotState::eFree;
+            });
+        });
+    }
+
+    m_extent = extent;
+    auto bufferSize = vk::DeviceSize(extent.width) * extent.height * 4;
+    for (auto &slot : m_slots) {
+        slot.data = nullptr;
+        slot.buffer.reset();
+        slot.memory.reset();
+
+        // Create a buffer which receives a copy of a whole image
+        slot.buffer = m_device.createBufferUnique(
+            vk::BufferCreateInfo()
+                .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSize(bufferSize)
+        );
+        auto requirements = m_device.getBufferMemoryRequirements(*slot.buffer);
+
+        // Allocate host-visible memory for it and keep it mapped
+        auto typeIndex = findReadbackMemoryType(requirements.memoryTypeBits);
+        m_coherent = static_cast<bool>(
+            m_memoryProperties.memoryTypes[typeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+        slot.memory = m_device.allocateMemoryUnique(
+            vk::MemoryAllocateInfo()
+                .setAllocationSize(requirements.size)
+                .setMemoryTypeIndex(typeIndex)
+        );
+        m_device.bindBufferMemory(*slot.buffer, *slot.memory, 0);
+
+        void *data;
+        vk::resultCheck(
+            m_device.mapMemory(*slot.memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), &data),
+            "vk::Device::mapMemory"
+        );
+        slot.data = static_cast<const uint8_t *>(data);
+    }
+}
+
+void FrameCapture::startContinuous(std::string directory, CaptureFormat format) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = std::move(directory);
+    m_captureFormat = format;
+    m_continuous = true;
+}
+
+bool FrameCapture::isContinuous() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_continuous;
+}
+
+void FrameCapture::requestSnapshot() {
+    m_snapshotRequested = true;
+}
+
+bool FrameCapture::takeSnapshot(CapturedImage &image) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_snapshotReady)
+        return false;
+    image = std::move(m_snapshot);
+    m_snapshotReady = false;
+    return true;
+}
+
+uint64_t FrameCapture::getDroppedFrames() const {
+    return m_droppedFrames;
+}
+
+void FrameCapture::recordCopy(vk::CommandBuffer commandBuffer, vk::Image image) {
+    if (!m_continuous && !m_snapshotRequested)
+        return;
+    m_frameCounter++;
+
+    // Claim a free buffer, if the encoder is too far behind the frame is dropped instead of waiting for it
+    ReadbackSlot *slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &candidate : m_slots) {
+            if (candidate.state == SlotState::eFree) {
+                slot = &candidate;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            m_droppedFrames++;
+            return;
+        }
+        slot->state = SlotState::eRecorded;
+        slot->frame = m_frameCounter;
+        slot->snapshot = m_snapshotRequested;
+    }
+    m_snapshotRequested = false;
+
+    // Copy the whole image, which the render graph has transitioned for transfers
+    commandBuffer.copyImageToBuffer(
+        image,
+        vk::ImageLayout::eTransferSrcOptimal,
+        *slot->buffer,
+        vk::BufferImageCopy()
+            .setBufferOffset(0)
+            .setBufferRowLength(0)
+            .setBufferImageHeight(0)
+            .setImageSubresource(
+                vk::ImageSubresourceLayers()
+                    .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                    .setMipLevel(0)
+                    .setBaseArrayLayer(0)
+                    .setLayerCount(1)
+            )
+            .setImageOffset({0, 0, 0})
+            .setImageExtent(vk::Extent3D(m_extent.width, m_extent.height, 1))
+    );
+
+    // Make the copy visible to host reads once the frame fence has signalled
+    auto barrier = vk::BufferMemoryBarrier()
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(*slot->buffer)
+        .setOffset(0)
+        .setSize(VK_WHOLE_SIZE);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(),
+        0, nullptr,
+        1, &barrier,
+        0, nullptr
+    );
+}
+
+void FrameCapture::collect() {
+    // All recorded copies belong to frames which have completed, so they can be handed to the encoder
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t index = 0; index < m_slots.size(); index++) {
+            if (m_slots[index].state != SlotState::eRecorded)
+                continue;
+            m_slots[index].state = SlotState::eEncoding;
+            m_jobs.push_back(index);
+        }
+    }
+    m_condition.notify_all();
+}
+
+// Appends a big-endian 32-bit integer to a byte vector
+static void appendUint32(std::vector<uint8_t> &bytes, uint32_t value) {
+    bytes.push_back(static_cast<uint8_t>(value >> 24));
+    bytes.push_back(static_cast<uint8_t>(value >> 16));
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a big-endian 32-bit integer from a byte array
+static uint32_t readUint32(const uint8_t *bytes) {
+    return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | uint32_t(bytes[3]);
+}
+
+// Computes the CRC-32 which PNG uses for its chunks
+static uint32_t computeCrc32(const uint8_t *data, size_t length) {
+    static const auto table = []() {
+        std::array<uint32_t, 256> table;
+        for (uint32_t index = 0; index < 256; index++) {
+            uint32_t value = index;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xedb88320 ^ (value >> 1) : value >> 1;
+            table[index] = value;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    for (size_t index = 0; index < length; index++)
+        crc = table[(crc ^ data[index]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+// Appends a PNG chunk consisting of length, type, data and CRC
+static void appendPngChunk(std::vector<uint8_t> &bytes, const char *type, const std::vector<uint8_t> &data) {
+    appendUint32(bytes, static_cast<uint32_t>(data.size()));
+    auto typeOffset = bytes.size();
+    bytes.insert(bytes.end(), type, type + 4);
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    appendUint32(bytes, computeCrc32(bytes.data() + typeOffset, bytes.size() - typeOffset));
+}
+
+void FrameCapture::writePng(const std::string &path, const CapturedImage &image) {
+    // Prefix each row with the "none" filter type
+    auto rowSize = size_t(image.width) * 4;
+    auto scanlines = std::vector<uint8_t>();
+    scanlines.reserve((rowSize + 1) * image.height);
+    for (uint32_t row = 0; row < image.height; row++) {
+        scanlines.push_back(0);
+        auto begin = image.pixels.begin() + row * rowSize;
+        scanlines.insert(scanlines.end(), begin, begin + rowSize);
+    }
+
+    // Wrap the rows into a zlib stream of uncompressed deflate blocks, which keeps encoding fast enough for
+    // continuous capture at the cost of file size
+    auto zlib = std::vector<uint8_t> { 0x78, 0x01 };
+    size_t offset = 0;
+    do {
+        auto length = static_cast<uint16_t>(std::min<size_t>(scanlines.size() - offset, 0xffff));
+        auto isFinal = offset + length == scanlines.size();
+        zlib.push_back(isFinal ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(length));
+        zlib.push_back(static_cast<uint8_t>(length >> 8));
+        zlib.push_back(static_cast<uint8_t>(~length));
+        zlib.push_back(static_cast<uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + length);
+        offset += length;
+    } while (offset < scanlines.size());
+
+    // Terminate the zlib stream with the Adler-32 checksum of the uncompressed data
+    uint32_t adlerLow = 1, adlerHigh = 0;
+    for (auto byte : scanlines) {
+        adlerLow = (adlerLow + byte) % 65521;
+        adlerHigh = (adlerHigh + adlerLow) % 65521;
+    }
+    appendUint32(zlib, (adlerHigh << 16) | adlerLow);
+
+    // Describe the image as 8-bit RGBA without interlacing
+    auto header = std::vector<uint8_t>();
+    appendUint32(header, image.width);
+    appendUint32(header, image.height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+
+    auto bytes = std::vector<uint8_t> { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    appendPngChunk(bytes, "IHDR", header);
+    appendPngChunk(bytes, "IDAT", zlib);
+    appendPngChunk(bytes, "IEND", {});
+
+    std::ofstream stream(path, std::ios::binary);
+    stream.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!stream.good())
+        throw std::runtime_error("Unable to write captured frame");
+}
+
+void FrameCapture::writeRaw(const std::string &path, const CapturedImage &image) {
+    // Prefix the rows with a header holding the extent, so that images of the same pixel count are told apart
+    auto header = std::vector<uint8_t>(k_rawMagic, k_rawMagic + 4);
+    appendUint32(header, image.width);
+    appendUint32(header, image.height);
+
+    std::ofstream stream(path, std::ios::binary);
+    stream.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    stream.write(reinterpret_cast<const char *>(image.pixels.data()),
+                 static_cast<std::streamsize>(image.pixels.size()));
+    if (!stream.good())
+        throw std::runtime_error("Unable to write captured frame");
+}
+
+bool FrameCapture::readRaw(const std::string &path, CapturedImage &image) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+        return false;
+
+    // Read and check the header
+    uint8_t header[12];
+    stream.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!stream.good() || !std::equal(k_rawMagic, k_rawMagic + 4, header))
+        throw std::runtime_error("Unable to read reference image header");
+    image.frame = 0;
+    image.width = readUint32(header + 4);
+    image.height = readUint32(header + 8);
+
+    // Read the rows which have to follow it
+    image.pixels.resize(size_t(image.width) * image.height * 4);
+    stream.read(reinterpret_cast<char *>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+    if (!stream.good())
+        throw std::runtime_error("Unable to read reference image");
+    return true;
+}
+
+ImageDifference FrameCapture::compare(const CapturedImage &image, const CapturedImage &reference, uint32_t tolerance) {
+    auto sizeMatches = image.width == reference.width && image.height == reference.height;
+    auto difference = ImageDifference { sizeMatches, 0, 0 };
+    if (!difference.sizeMatches)
+        return difference;
+
+    // Count the pixels where any channel differs by more than the tolerance
+    for (size_t pixel = 0; pixel < image.pixels.size(); pixel += 4) {
+        auto exceeds = false;
+        for (size_t channel = pixel; channel < pixel + 4; channel++) {
+            auto channelDifference = static_cast<uint32_t>(std::abs(image.pixels[channel] - reference.pixels[channel]));
+            difference.maxChannelDifference = std::max(difference.maxChannelDifference, channelDifference);
+            exceeds = exceeds || channelDifference > tolerance;
+        }
+        if (exceeds)
+            difference.differentPixels++;
+    }
+    return difference;
+}
+
+void FrameCapture::runEncoder() {
+    for (;;) {
+        // Wait for the next completed copy
+        size_t index;
+        bool continuous;
+        std::string directory;
+        CaptureFormat format;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+            if (m_jobs.empty())
+                return;
+            index = m_jobs.front();
+            m_jobs.pop_front();
+            continuous = m_continuous;
+            directory = m_directory;
+            format = m_captureFormat;
+        }
+
+        // Convert the copy and release its buffer as early as possible
+        auto &slot = m_slots[index];
+        auto image = readSlot(slot);
+        auto snapshot = slot.snapshot;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            slot.state = SlotState::eFree;
+        }
+        m_condition.notify_all();
+
+        // Encode continuous captures to disk, failures are reported without stopping the renderer
+        if (continuous) {
+            try {
+                char name[32];
+                std::snprintf(name, sizeof(name), "frame_%06llu.%s", static_cast<unsigned long long>(image.frame),
+                              format == CaptureFormat::ePng ? "png" : "raw");
+                if (format == CaptureFormat::ePng)
+                    writePng(directory + "/" + name, image);
+                else
+                    writeRaw(directory + "/" + name, image);
+            } catch (const std::exception &exception) {
+                std::cerr << "[FrameCapture] " << exception.what() << std::endl;
+            }
+        }
+
+        // Hand snapshots to the render loop
+        if (snapshot) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_snapshot = std::move(image);
+            m_snapshotReady = true;
+        }
+    }
+}
+
+CapturedImage FrameCapture::readSlot(const ReadbackSlot &slot) {
+    // Make device writes visible if the memory is not coherent
+    if (!m_coherent) {
+        m_device.invalidateMappedMemoryRanges(
+            vk::MappedMemoryRange()
+                .setMemory(*slot.memory)
+                .setOffset(0)
+                .setSize(VK_WHOLE_SIZE)
+        );
+    }
+
+    auto image = CapturedImage { slot.frame, m_extent.width, m_extent.height, {} };
+    image.pixels.assign(slot.data, slot.data + size_t(m_extent.width) * m_extent.height * 4);
+
+    // Swap the red and blue channels of BGRA images
+    if (m_format == vk::Format::eB8G8R8A8Unorm || m_format == vk::Format::eB8G8R8A8Srgb) {
+        for (size_t pixel = 0; pixel < image.pixels.size(); pixel += 4)
+            std::swap(image.pixels[pixel], image.pixels[pixel + 2]);
+    }
+    return image;
+}
+
+uint32_t FrameCapture::findReadbackMemoryType(uint32_t typeFilter) {
+    // Prefer cached memory since it is read by the CPU, but accept any host-visible memory
+    const vk::MemoryPropertyFlags preferences[] = {
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached,
+        vk::MemoryPropertyFlagBits::eHostVisible,
+    };
+    for (auto flags : preferences) {
+        for (uint32_t index = 0; index < m_memoryProperties.memoryTypeCount; index++) {
+            if (typeFilter & (1 << index) && (m_memoryProperties.memoryTypes[index].propertyFlags & flags) == flags)
+                return index;
+        }
+    }
+    throw std::runtime_error("Unable to find memory type for frame capture");
+}
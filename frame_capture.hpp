@@ -0,0 +1,106 @@
+#pragma once
+
+#include "pch.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// File formats written by continuous capture, raw files contain a header with the magic `VTRI` and the big-endian
+// width and height followed by tightly packed RGBA8 rows
+enum class CaptureFormat {
+    ePng,
+    eRaw,
+};
+
+// A captured frame converted to tightly packed RGBA8 rows
+struct CapturedImage {
+    uint64_t             frame;
+    uint32_t             width;
+    uint32_t             height;
+    std::vector<uint8_t> pixels;
+};
+
+// Result of comparing a captured frame to a reference image
+struct ImageDifference {
+    bool     sizeMatches;
+    uint64_t differentPixels;
+    uint32_t maxChannelDifference;
+};
+
+// Copies swapchain images into a ring of host-visible readback buffers, hands them to a background thread once their
+// frame has completed and encodes them there; a frame is dropped instead of stalling if every buffer is still in use
+class FrameCapture {
+public:
+    FrameCapture();
+    ~FrameCapture();
+
+    // Setup, `resize` has to be called while the device is idle
+    void create(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties, vk::Format format);
+    void resize(vk::Extent2D extent);
+
+    // Control
+    void startContinuous(std::string directory, CaptureFormat format);
+    bool isContinuous();
+    void requestSnapshot();
+    bool takeSnapshot(CapturedImage &image);
+    uint64_t getDroppedFrames() const;
+
+    // Frame integration, `collect` may only be called once the frame fence has signalled
+    void recordCopy(vk::CommandBuffer commandBuffer, vk::Image image);
+    void collect();
+
+    // Encoding and golden-image comparison
+    static void writePng(const std::string &path, const CapturedImage &image);
+    static void writeRaw(const std::string &path, const CapturedImage &image);
+    static bool readRaw(const std::string &path, CapturedImage &image);
+    static ImageDifference compare(const CapturedImage &image, const CapturedImage &reference, uint32_t tolerance);
+private:
+    static constexpr size_t  k_slotCount = 3;
+    static constexpr uint8_t k_rawMagic[4] = { 'V', 'T', 'R', 'I' };
+
+    enum class SlotState {
+        eFree,
+        eRecorded,
+        eEncoding,
+    };
+
+    struct ReadbackSlot {
+        vk::UniqueBuffer       buffer;
+        vk::UniqueDeviceMemory memory;
+        const uint8_t         *data = nullptr;
+        SlotState              state = SlotState::eFree;
+        uint64_t               frame = 0;
+        bool                   snapshot = false;
+    };
+
+    vk::Device                            m_device;
+    vk::PhysicalDeviceMemoryProperties    m_memoryProperties;
+    vk::Format                            m_format;
+    vk::Extent2D                          m_extent;
+    bool                                  m_coherent;
+    std::array<ReadbackSlot, k_slotCount> m_slots;
+    uint64_t                              m_frameCounter;
+    uint64_t                              m_droppedFrames;
+    bool                                  m_snapshotRequested;
+
+    // State shared with the encoder thread
+    std::mutex                            m_mutex;
+    std::condition_variable               m_condition;
+    std::deque<size_t>                    m_jobs;
+    bool                                  m_continuous;
+    std::string                           m_directory;
+    CaptureFormat                         m_captureFormat;
+    bool                                  m_stopping;
+    bool                                  m_snapshotReady;
+    CapturedImage                         m_snapshot;
+    std::thread                           m_encoder;
+
+    void runEncoder();
+    CapturedImage readSlot(const ReadbackSlot &slot);
+    uint32_t findReadbackMemoryType(uint32_t typeFilter);
+};
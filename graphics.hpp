@@ -1,6 +1,9 @@
 #pragma once
 
+#include "frame_capture.hpp"
 #include "pch.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
 
 #include <array>
 #include <vector>
@@ -36,17 +39,22 @@ using SpirvCode = std::vector<uint32_t>;
 
 class Graphics {
 public:
-    explicit Graphics(glfw::Window &window);
+    Graphics(glfw::Window &window, uint32_t sampleCount, bool captureEnabled, bool forceRenderPass);
     ~Graphics();
 
     void renderFrame();
     void handleResize();
+    void setSampleCount(uint32_t sampleCount);
+    void pollCaptures();
+    Profiler &profiler();
+    FrameCapture &capture();
 private:
     static std::vector<Vertex>         k_vertexData;
     glfw::Window                      &m_window;
+    uint32_t                           m_apiVersion;
     vk::UniqueInstance                 m_instance;
+    vk::DispatchLoaderDynamic          m_dispatch;
 #ifdef ENABLE_VALIDATION
-    vk::DispatchLoaderDynamic                                               m_dispatch;
     vk::UniqueHandle<vk::DebugUtilsMessengerEXT, vk::DispatchLoaderDynamic> m_messenger;
 #endif
     vk::UniqueSurfaceKHR               m_surface;
@@ -56,6 +64,12 @@ private:
     vk::SurfaceFormatKHR               m_surfaceFormat;
     uint32_t                           m_queueFamilyIndex;
     vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+    vk::PhysicalDeviceFeatures         m_enabledFeatures;
+    bool                               m_forceRenderPass;
+    bool                               m_dynamicRendering;
+    vk::Format                         m_depthFormat;
+    vk::SampleCountFlagBits            m_sampleCount;
+    bool                               m_captureEnabled;
     vk::UniqueDevice                   m_logicalDevice;
     vk::UniqueFence                    m_nextFrameFence;
     vk::UniqueSemaphore                m_imageAcquireSema;
@@ -64,6 +78,7 @@ private:
     vk::Extent2D                       m_imageExtent;
     vk::UniqueSwapchainKHR             m_swapchain;
     vk::UniqueRenderPass               m_renderPass;
+    std::vector<vk::Image>             m_images;
     std::vector<vk::UniqueImageView>   m_imageViews;
     std::vector<vk::UniqueFramebuffer> m_framebuffers;
     vk::UniqueShaderModule             m_shaderModules[2];
@@ -76,6 +91,12 @@ private:
     vk::UniqueDeviceMemory             m_vertexMemory;
     vk::UniqueCommandPool              m_commandPool;
     vk::UniqueCommandBuffer            m_commandBuffer;
+    Profiler                           m_profiler;
+    RenderGraph                        m_renderGraph;
+    RenderGraph::ResourceId            m_backbuffer;
+    RenderGraph::ResourceId            m_colorTarget;
+    RenderGraph::ResourceId            m_depthTarget;
+    FrameCapture                       m_capture;
 
     // Preparation
     void createInstanceAndSurface();
@@ -85,10 +106,14 @@ private:
     // Device and presentation setup
     void selectPhysicalDevice();
     void createLogicalDevice();
+    void selectDepthFormat();
+    void selectSampleCount(uint32_t sampleCount);
     void createRenderSync();
     void createSwapchain();
     void createRenderPass();
     void createImageViews();
+    void createRenderGraph();
+    void compileRenderGraph();
     void createFramebuffers();
 
     // Rendering setup
@@ -97,9 +122,14 @@ private:
     void createGraphicsPipeline();
     void createVertexBuffer();
     void createCommandBuffer();
+    void createProfiler();
+    void createFrameCapture();
 
     // Object usage
     void recordCommandBuffer(uint32_t imageIndex);
+    void recordMainPass(vk::CommandBuffer commandBuffer);
+    void beginMainRendering(vk::CommandBuffer commandBuffer);
+    void endMainRendering(vk::CommandBuffer commandBuffer);
     uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags flags);
 
     // Callback for debug messages
@@ -1,5 +1,6 @@
 #include "graphics.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <cstdint>
 #include <stdexcept>
@@ -8,7 +9,16 @@
 #include <iostream>
 #endif
 
-Graphics::Graphics(glfw::Window &window): m_window(window), m_queueFamilyIndex(0xffffffff) {
+Graphics::Graphics(glfw::Window &window, uint32_t sampleCount, bool captureEnabled, bool forceRenderPass):
+    m_window(window),
+    m_apiVersion(VK_API_VERSION_1_0),
+    m_queueFamilyIndex(0xffffffff),
+    m_forceRenderPass(forceRenderPass),
+    m_dynamicRendering(false),
+    m_depthFormat(vk::Format::eUndefined),
+    m_sampleCount(vk::SampleCountFlagBits::e1),
+    m_captureEnabled(captureEnabled)
+{
     // Preparation
     createInstanceAndSurface();
     loadAndCompileShaders();
@@ -16,10 +26,14 @@ Graphics::Graphics(glfw::Window &window): m_window(window), m_queueFamilyIndex(0
     // Setup devices and presentation
     selectPhysicalDevice();
     createLogicalDevice();
+    selectDepthFormat();
+    selectSampleCount(sampleCount);
     createRenderSync();
     createSwapchain();
     createRenderPass();
     createImageViews();
+    createRenderGraph();
+    compileRenderGraph();
     createFramebuffers();
 
     // Rendering setup
@@ -28,6 +42,8 @@ Graphics::Graphics(glfw::Window &window): m_window(window), m_queueFamilyIndex(0
     createGraphicsPipeline();
     createVertexBuffer();
     createCommandBuffer();
+    createProfiler();
+    createFrameCapture();
 }
 
 Graphics::~Graphics() {
@@ -47,16 +63,36 @@ void Graphics::createInstanceAndSurface() {
     extensions.push_back("VK_EXT_debug_utils");
 #endif
 
+    // A Vulkan 1.0 loader has no `vkEnumerateInstanceVersion` and rejects any higher API version, so it is looked up
+    // at runtime instead of being linked against
+    auto instanceVersion = uint32_t(VK_API_VERSION_1_0);
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        glfw::getInstanceProcAddress(nullptr, "vkEnumerateInstanceVersion")
+    );
+    if (enumerateInstanceVersion != nullptr)
+        vk::resultCheck(vk::Result(enumerateInstanceVersion(&instanceVersion)), "vkEnumerateInstanceVersion");
+
+    // Request up to Vulkan 1.3 so that dynamic rendering can be used where supported, older loaders and devices
+    // use the legacy render pass path
+    m_apiVersion = std::min(instanceVersion, uint32_t(VK_API_VERSION_1_3));
+    auto applicationInfo = vk::ApplicationInfo()
+        .setPApplicationName("vulkan_triangle")
+        .setApiVersion(m_apiVersion);
+
     // Create instance with the collected extensions and layers
     m_instance = vk::createInstanceUnique(
         vk::InstanceCreateInfo()
+            .setPApplicationInfo(&applicationInfo)
             .setPEnabledLayerNames(layers)
             .setPEnabledExtensionNames(extensions)
     );
 
-#ifdef ENABLE_VALIDATION
-    // Optionally create a dynamic dispatch for the debug extension and a messenger to the callback function
+    // Load extensions and entry points newer than Vulkan 1.0 at runtime, so that the binary does not link against
+    // loader exports which older loaders lack
     m_dispatch = vk::DispatchLoaderDynamic(*m_instance, glfw::getInstanceProcAddress);
+
+#ifdef ENABLE_VALIDATION
+    // Optionally create a messenger to the callback function
     m_messenger = m_instance->createDebugUtilsMessengerEXTUnique(
         vk::DebugUtilsMessengerCreateInfoEXT()
             .setMessageSeverity(vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo |
@@ -42,6 +42,22 @@ void Graphics::createLogicalDevice() {
         .setPQueuePriorities(&queuePriority)
         .setQueueCount(1);
 
+    // Enable pipeline statistics queries for profiling if the device supports them
+    auto supportedFeatures = m_physicalDevice.getFeatures();
+    m_enabledFeatures = vk::PhysicalDeviceFeatures()
+        .setPipelineStatisticsQuery(supportedFeatures.pipelineStatisticsQuery);
+
+    // Use dynamic rendering if both the instance and the device support Vulkan 1.3 and the device has the feature,
+    // otherwise or if the render pass path was forced fall back to render passes
+    auto vulkan13Features = vk::PhysicalDeviceVulkan13Features();
+    auto deviceVersion = m_physicalDevice.getProperties().apiVersion;
+    if (!m_forceRenderPass && m_apiVersion >= VK_API_VERSION_1_3 && deviceVersion >= VK_API_VERSION_1_3) {
+        auto supportedFeatures2 = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                                                vk::PhysicalDeviceVulkan13Features>(m_dispatch);
+        m_dynamicRendering = supportedFeatures2.get<vk::PhysicalDeviceVulkan13Features>().dynamicRendering == VK_TRUE;
+        vulkan13Features.setDynamicRendering(m_dynamicRendering);
+    }
+
     // Create a logical device with swapchain support
     static const char *swapchainExtension = "VK_KHR_swapchain";
     m_logicalDevice = m_physicalDevice.createDeviceUnique(
@@ -50,12 +66,44 @@ void Graphics::createLogicalDevice() {
             .setEnabledExtensionCount(1)
             .setPQueueCreateInfos(&queueCreateInfo)
             .setQueueCreateInfoCount(1)
+            .setPEnabledFeatures(&m_enabledFeatures)
+            .setPNext(m_dynamicRendering ? &vulkan13Features : nullptr)
     );
 
+    // Load device-level entry points (e.g. dynamic rendering commands) directly from the driver
+    m_dispatch.init(*m_logicalDevice);
+
     // Obtain the created queue's handle
     m_queue = m_logicalDevice->getQueue(m_queueFamilyIndex, 0);
 }
 
+void Graphics::selectDepthFormat() {
+    // Use the most precise depth-only format which can be a depth attachment, the last one is always supported
+    static const vk::Format candidates[] = {
+        vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32, vk::Format::eD16Unorm,
+    };
+    for (auto format : candidates) {
+        auto properties = m_physicalDevice.getFormatProperties(format);
+        if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+            m_depthFormat = format;
+            return;
+        }
+    }
+    throw std::runtime_error("No supported depth format was found");
+}
+
+void Graphics::selectSampleCount(uint32_t sampleCount) {
+    // Use the highest sample count not above the requested one that color and depth attachments both support
+    auto limits = m_physicalDevice.getProperties().limits;
+    auto supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+    m_sampleCount = vk::SampleCountFlagBits::e1;
+    for (uint32_t samples = 2; samples <= 64 && samples <= sampleCount; samples <<= 1) {
+        auto sampleBit = static_cast<vk::SampleCountFlagBits>(samples);
+        if (supported & sampleBit)
+            m_sampleCount = sampleBit;
+    }
+}
+
 void Graphics::createRenderSync() {
     // Create a fence which prevents the render loop from acquiring the next image until the current image is rendered,
     // it is initialized to be in signalled state so the first render can occur
@@ -85,6 +133,14 @@ void Graphics::createSwapchain() {
         throw std::runtime_error("Unable create swapchain with given image extent");
     }
 
+    // Images have to be copyable for frame capture
+    auto imageUsage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eColorAttachment);
+    if (m_captureEnabled) {
+        if (!(capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc))
+            throw std::runtime_error("Unable to create swapchain with copyable images for capture");
+        imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+    }
+
     uint32_t minImageCount = capabilities.minImageCount + 1;
     if (capabilities.maxImageCount != 0 && minImageCount > capabilities.maxImageCount)
         minImageCount = capabilities.maxImageCount;
@@ -100,7 +156,7 @@ void Graphics::createSwapchain() {
                 // Swap through `minImageCount` images with color attachment
             .setImageFormat(m_surfaceFormat.format)
             .setImageColorSpace(m_surfaceFormat.colorSpace)
-            .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
+            .setImageUsage(imageUsage)
             .setImageExtent(m_imageExtent)
             .setImageArrayLayers(1)
             .setMinImageCount(minImageCount)
@@ -108,43 +164,67 @@ void Graphics::createSwapchain() {
 }
 
 void Graphics::createRenderPass() {
-    // Define the color attachment
-    auto colorDescription = vk::AttachmentDescription()
+    // Dynamic rendering begins rendering directly on image views and needs no render pass
+    if (m_dynamicRendering)
+        return;
+
+    auto multisampled = m_sampleCount != vk::SampleCountFlagBits::e1;
+
+    // Define the attachments, their layout transitions are performed by the render graph's barriers; only the
+    // swapchain image is stored, multisampled color and depth are discarded so tilers never write them to memory
+    std::array<vk::AttachmentDescription, 3> descriptions;
+    descriptions[0] = vk::AttachmentDescription()
         .setFormat(m_surfaceFormat.format)
-        .setSamples(vk::SampleCountFlagBits::e1)
+        .setSamples(m_sampleCount)
+        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(multisampled ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore)
+        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+        .setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
+    descriptions[1] = vk::AttachmentDescription()
+        .setFormat(m_depthFormat)
+        .setSamples(m_sampleCount)
         .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+        .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+        .setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    descriptions[2] = vk::AttachmentDescription()
+        .setFormat(m_surfaceFormat.format)
+        .setSamples(vk::SampleCountFlagBits::e1)
+        .setLoadOp(vk::AttachmentLoadOp::eDontCare)
         .setStoreOp(vk::AttachmentStoreOp::eStore)
         .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
         .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-        .setInitialLayout(vk::ImageLayout::eUndefined)
-        .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+        .setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+        .setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
 
-    // Define a single subpass which reference the color attachment
+    // Define a single subpass which references the attachments, resolving into the swapchain image if multisampled
     auto colorReference = vk::AttachmentReference()
         .setAttachment(0)
         .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+    auto depthReference = vk::AttachmentReference()
+        .setAttachment(1)
+        .setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    auto resolveReference = vk::AttachmentReference()
+        .setAttachment(2)
+        .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
     auto subpass = vk::SubpassDescription()
         .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
         .setPColorAttachments(&colorReference)
-        .setColorAttachmentCount(1);
-
-    // Define a dependency for image acquisition before the render pass is started
-    auto dependency = vk::SubpassDependency()
-        .setSrcSubpass(VK_SUBPASS_EXTERNAL)
-        .setDstSubpass(0)
-        .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-        .setSrcAccessMask(vk::AccessFlagBits::eNone)
-        .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-        .setDstAccessMask(vk::AccessFlagBits::eNone);
+        .setColorAttachmentCount(1)
+        .setPDepthStencilAttachment(&depthReference)
+        .setPResolveAttachments(multisampled ? &resolveReference : nullptr);
 
+    // Synchronization with image acquisition and presentation is handled by the render graph
     m_renderPass = m_logicalDevice->createRenderPassUnique(
         vk::RenderPassCreateInfo()
-            .setPAttachments(&colorDescription)
-            .setAttachmentCount(1)
+            .setPAttachments(descriptions.data())
+            .setAttachmentCount(multisampled ? 3 : 2)
             .setPSubpasses(&subpass)
             .setSubpassCount(1)
-            .setPDependencies(&dependency)
-            .setDependencyCount(1)
     );
 }
 
@@ -162,34 +242,100 @@ void Graphics::createImageViews() {
                 .setLayerCount(1)
         );
 
-    // Reserve space for each new image view handle
-    auto images = m_logicalDevice->getSwapchainImagesKHR(*m_swapchain);
-    m_imageViews.reserve(images.size());
+    // Keep the images for the render graph and reserve space for each new image view handle
+    m_images = m_logicalDevice->getSwapchainImagesKHR(*m_swapchain);
+    m_imageViews.reserve(m_images.size());
 
     // Create a view for each image in the swapchain
-    for (auto image : images) {
+    for (auto image : m_images) {
         m_imageViews.push_back(
             m_logicalDevice->createImageViewUnique(createInfo.setImage(image))
         );
     }
 }
 
+void Graphics::createRenderGraph() {
+    // Drop the declarations of a previous sample count
+    m_renderGraph.clear();
+
+    // Import the swapchain image, it is ready once the acquire semaphore was waited for and has to be presentable
+    m_backbuffer = m_renderGraph.importImage(
+        "backbuffer",
+        vk::ImageAspectFlagBits::eColor,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::ImageLayout::ePresentSrcKHR
+    );
+
+    // Define the depth buffer and, if multisampled, a color target which is resolved into the swapchain image; both
+    // only live within the main pass, so they can be lazily allocated
+    m_depthTarget = m_renderGraph.createTransientImage("depth", TransientImageInfo {
+        m_depthFormat,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+        vk::ImageAspectFlagBits::eDepth,
+        m_sampleCount
+    });
+    if (m_sampleCount != vk::SampleCountFlagBits::e1) {
+        m_colorTarget = m_renderGraph.createTransientImage("multisampledColor", TransientImageInfo {
+            m_surfaceFormat.format,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+            vk::ImageAspectFlagBits::eColor,
+            m_sampleCount
+        });
+    } else {
+        m_colorTarget = m_backbuffer;
+    }
+
+    // Define the main pass which draws the triangle into the swapchain image
+    auto mainPass = m_renderGraph.addPass("main", [this](vk::CommandBuffer commandBuffer) {
+        recordMainPass(commandBuffer);
+    });
+    m_renderGraph.addWrite(mainPass, m_depthTarget, ResourceUsage::eDepthAttachment);
+    m_renderGraph.addWrite(mainPass, m_backbuffer, ResourceUsage::eColorAttachment);
+    if (m_colorTarget != m_backbuffer)
+        m_renderGraph.addWrite(mainPass, m_colorTarget, ResourceUsage::eColorAttachment);
+
+    // Optionally define a pass which copies the finished image for capture, it has no outputs within the graph
+    if (m_captureEnabled) {
+        auto capturePass = m_renderGraph.addPass("capture", [this](vk::CommandBuffer commandBuffer) {
+            m_capture.recordCopy(commandBuffer, m_renderGraph.getImage(m_backbuffer));
+        });
+        m_renderGraph.addRead(capturePass, m_backbuffer, ResourceUsage::eTransferSrc);
+        m_renderGraph.setSideEffect(capturePass);
+    }
+}
+
+void Graphics::compileRenderGraph() {
+    // Schedule the passes, compute their barriers and allocate transient images for the current extent
+    m_renderGraph.compile(*m_logicalDevice, m_memoryProperties, m_imageExtent);
+}
+
 void Graphics::createFramebuffers() {
-    // Define a framebuffer of the previously set image extent with a color attachment
+    // Dynamic rendering needs no framebuffers, so a resize does not have to re-create any
+    if (m_dynamicRendering)
+        return;
+
+    // Define a framebuffer of the previously set image extent with the render pass' attachments, the swapchain
+    // image is either the color or the resolve attachment
+    auto multisampled = m_colorTarget != m_backbuffer;
+    auto attachments = std::array<vk::ImageView, 3> {
+        vk::ImageView(), m_renderGraph.getImageView(m_depthTarget), vk::ImageView()
+    };
     auto createInfo = vk::FramebufferCreateInfo()
         .setRenderPass(*m_renderPass)
-        .setAttachmentCount(1)
+        .setPAttachments(attachments.data())
+        .setAttachmentCount(multisampled ? 3 : 2)
         .setWidth(m_imageExtent.width)
         .setHeight(m_imageExtent.height)
         .setLayers(1);
+    if (multisampled)
+        attachments[0] = m_renderGraph.getImageView(m_colorTarget);
 
     // Reserve space for each new framebuffer
     m_framebuffers.reserve(m_imageViews.size());
 
     // Create a framebuffer for each image view
     for (auto &imageView : m_imageViews) {
-        m_framebuffers.push_back(
-            m_logicalDevice->createFramebufferUnique(createInfo.setPAttachments(&imageView.get()))
-        );
+        attachments[multisampled ? 2 : 0] = *imageView;
+        m_framebuffers.push_back(m_logicalDevice->createFramebufferUnique(createInfo));
     }
 }
\ No newline at end of file
@@ -67,14 +67,22 @@ void Graphics::createGraphicsPipeline() {
         .setFrontFace(vk::FrontFace::eClockwise)
         .setDepthBiasEnable(VK_FALSE);
 
-    // Define multisampling to be disabled
+    // Define multisampling with the selected sample count, without per-sample shading
     auto multisampleInfo = vk::PipelineMultisampleStateCreateInfo()
         .setSampleShadingEnable(VK_FALSE)
-        .setRasterizationSamples(vk::SampleCountFlagBits::e1)
+        .setRasterizationSamples(m_sampleCount)
         .setMinSampleShading(1.0)
         .setAlphaToCoverageEnable(VK_FALSE)
         .setAlphaToOneEnable(VK_FALSE);
 
+    // Define depth testing which keeps the nearest fragments
+    auto depthStencilInfo = vk::PipelineDepthStencilStateCreateInfo()
+        .setDepthTestEnable(VK_TRUE)
+        .setDepthWriteEnable(VK_TRUE)
+        .setDepthCompareOp(vk::CompareOp::eLess)
+        .setDepthBoundsTestEnable(VK_FALSE)
+        .setStencilTestEnable(VK_FALSE);
+
     // Define color blending to be disabled
     auto colorBlendAttachment = vk::PipelineColorBlendAttachmentState()
         .setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
@@ -105,10 +113,17 @@ void Graphics::createGraphicsPipeline() {
         vk::PipelineLayoutCreateInfo()
     );
 
+    // With dynamic rendering, the pipeline is only compatible with the attachment formats instead of a render pass
+    auto renderingInfo = vk::PipelineRenderingCreateInfo()
+        .setPColorAttachmentFormats(&m_surfaceFormat.format)
+        .setColorAttachmentCount(1)
+        .setDepthAttachmentFormat(m_depthFormat);
+
     m_graphicsPipeline = m_logicalDevice->createGraphicsPipelineUnique(
         nullptr,
         vk::GraphicsPipelineCreateInfo()
-            .setRenderPass(*m_renderPass)
+            .setPNext(m_dynamicRendering ? &renderingInfo : nullptr)
+            .setRenderPass(m_dynamicRendering ? vk::RenderPass() : *m_renderPass)
             .setPStages(m_shaderStages)
             .setStageCount(2)
             .setPDynamicState(&dynamicStateInfo)
@@ -116,6 +131,7 @@ void Graphics::createGraphicsPipeline() {
             .setPInputAssemblyState(&inputAssemblyInfo)
             .setPRasterizationState(&rasterizationInfo)
             .setPMultisampleState(&multisampleInfo)
+            .setPDepthStencilState(&depthStencilInfo)
             .setPColorBlendState(&colorBlendInfo)
             .setPViewportState(&viewportInfo)
             .setLayout(*m_graphicsPipelineLayout)
@@ -175,3 +191,23 @@ void Graphics::createCommandBuffer() {
         throw std::runtime_error("Unable to allocate command buffer");
     m_commandBuffer = std::move(commandBuffers[0]);
 }
+
+void Graphics::createProfiler() {
+    // Create the per-frame query pools, pipeline statistics are only collected if the feature was enabled
+    m_profiler.createQueryPools(m_physicalDevice, *m_logicalDevice, m_queueFamilyIndex,
+                                m_enabledFeatures.pipelineStatisticsQuery == VK_TRUE);
+
+#ifdef ENABLE_VALIDATION
+    // Optionally label profiled command buffer regions for debugging tools
+    m_profiler.setDebugDispatch(&m_dispatch);
+#endif
+}
+
+void Graphics::createFrameCapture() {
+    if (!m_captureEnabled)
+        return;
+
+    // Start the encoder and create readback buffers matching the swapchain images
+    m_capture.create(*m_logicalDevice, m_memoryProperties, m_surfaceFormat.format);
+    m_capture.resize(m_imageExtent);
+}
@@ -2,25 +2,38 @@
 
 void Graphics::renderFrame() {
     // Wait for the next frame
-    vk::resultCheck(
-        m_logicalDevice->waitForFences(1, &m_nextFrameFence.get(), VK_TRUE, UINT64_MAX),
-        "vk::Device::waitForFences"
-    );
-    vk::resultCheck(
-        m_logicalDevice->resetFences(1, &m_nextFrameFence.get()),
-        "vk::Device::resetFences"
-    );
+    {
+        ProfileScope scope(m_profiler, "waitForFrame");
+        vk::resultCheck(
+            m_logicalDevice->waitForFences(1, &m_nextFrameFence.get(), VK_TRUE, UINT64_MAX),
+            "vk::Device::waitForFences"
+        );
+        vk::resultCheck(
+            m_logicalDevice->resetFences(1, &m_nextFrameFence.get()),
+            "vk::Device::resetFences"
+        );
+    }
+
+    // The previous frame has completed, so its captured copies can be encoded
+    if (m_captureEnabled)
+        m_capture.collect();
 
     // Acquire the next image for rendering
     uint32_t imageIndex;
-    vk::resultCheck(
-        m_logicalDevice->acquireNextImageKHR(*m_swapchain, UINT64_MAX, *m_imageAcquireSema, {}, &imageIndex),
-        "vk::Device::acquireNextImageKHR",
-        { vk::Result::eSuccess, vk::Result::eSuboptimalKHR }
-    );
+    {
+        ProfileScope scope(m_profiler, "acquireImage");
+        vk::resultCheck(
+            m_logicalDevice->acquireNextImageKHR(*m_swapchain, UINT64_MAX, *m_imageAcquireSema, {}, &imageIndex),
+            "vk::Device::acquireNextImageKHR",
+            { vk::Result::eSuccess, vk::Result::eSuboptimalKHR }
+        );
+    }
 
     // Record and submit the command buffer
-    recordCommandBuffer(imageIndex);
+    {
+        ProfileScope scope(m_profiler, "recordCommands");
+        recordCommandBuffer(imageIndex);
+    }
     auto waitStage = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
     auto submitInfo = vk::SubmitInfo()
         .setPWaitSemaphores(&m_imageAcquireSema.get())
@@ -33,6 +46,7 @@ void Graphics::renderFrame() {
     vk::resultCheck(m_queue.submit(1, &submitInfo, *m_nextFrameFence), "vk::Queue::submit");
 
     // Queue presentation to occur when rendering is finished
+    ProfileScope scope(m_profiler, "present");
     vk::resultCheck(
         m_queue.presentKHR(vk::PresentInfoKHR()
                                .setPWaitSemaphores(&m_renderFinishSema.get())
@@ -62,45 +76,145 @@ void Graphics::handleResize() {
     // Re-create the swapchain and resources that depend on it
     createSwapchain();
     createImageViews();
+    compileRenderGraph();
     createFramebuffers();
 
+    // Re-create the capture buffers for the new extent
+    if (m_captureEnabled)
+        m_capture.resize(m_imageExtent);
+
     // Re-create the graphics pipeline
     initViewportAndScissor();
     createGraphicsPipeline();
 }
 
+void Graphics::setSampleCount(uint32_t sampleCount) {
+    // Wait for pending operations to finish
+    m_logicalDevice->waitIdle();
+
+    // Destroy the graphics pipeline and the resources that depend on the sample count
+    m_graphicsPipelineLayout.reset();
+    m_graphicsPipeline.reset();
+    m_framebuffers.clear();
+    m_renderPass.reset();
+
+    // Re-create them with the sample count clamped to the device's limits
+    selectSampleCount(sampleCount);
+    createRenderPass();
+    createRenderGraph();
+    compileRenderGraph();
+    createFramebuffers();
+    createGraphicsPipeline();
+}
+
+void Graphics::pollCaptures() {
+    // Hand over the last frame's copies without waiting if it has already completed
+    if (m_captureEnabled && m_logicalDevice->getFenceStatus(*m_nextFrameFence) == vk::Result::eSuccess)
+        m_capture.collect();
+}
+
+Profiler &Graphics::profiler() {
+    return m_profiler;
+}
+
+FrameCapture &Graphics::capture() {
+    return m_capture;
+}
+
 void Graphics::recordCommandBuffer(uint32_t imageIndex) {
-    // Reset the buffer and start recording
+    // Reset the buffer, start recording and open the profiled frame
     m_commandBuffer->reset();
     m_commandBuffer->begin(vk::CommandBufferBeginInfo());
+    m_profiler.beginFrame(*m_commandBuffer);
+
+    // Record the frame's passes into the acquired image, its framebuffer only exists without dynamic rendering
+    auto framebuffer = m_dynamicRendering ? vk::Framebuffer() : *m_framebuffers[imageIndex];
+    m_renderGraph.setImportedImage(m_backbuffer, m_images[imageIndex], *m_imageViews[imageIndex], framebuffer);
+    m_renderGraph.execute(*m_commandBuffer, m_profiler);
+
+    // End profiling and recording
+    m_profiler.endFrame(*m_commandBuffer);
+    m_commandBuffer->end();
+}
+
+void Graphics::recordMainPass(vk::CommandBuffer commandBuffer) {
+    beginMainRendering(commandBuffer);
 
-    // Start the render pass with a solid black clear color
+    // Bind the graphics pipeline
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *m_graphicsPipeline);
+
+    // Set viewport and scissor
+    commandBuffer.setViewport(0, 1, &m_viewport);
+    commandBuffer.setScissor(0, 1, &m_scissor);
+
+    // Draw the triangle
+    commandBuffer.bindVertexBuffers(0, {*m_vertexBuffer}, {0});
+    commandBuffer.draw(k_vertexData.size(), 1, 0, 0);
+
+    endMainRendering(commandBuffer);
+}
+
+void Graphics::beginMainRendering(vk::CommandBuffer commandBuffer) {
+    // Clear to a solid black color
     auto clearValue = vk::ClearValue()
         .setColor({0.0f, 0.0f, 0.0f, 1.0f});
-    m_commandBuffer->beginRenderPass(
+
+    auto depthClearValue = vk::ClearValue()
+        .setDepthStencil({1.0f, 0});
+
+    if (m_dynamicRendering) {
+        // Begin rendering directly on the acquired image's view, or on the multisampled target which is resolved into
+        // it in-pass; everything but the swapchain image is discarded afterwards
+        auto colorAttachment = vk::RenderingAttachmentInfo()
+            .setImageView(m_renderGraph.getImageView(m_backbuffer))
+            .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+            .setLoadOp(vk::AttachmentLoadOp::eClear)
+            .setStoreOp(vk::AttachmentStoreOp::eStore)
+            .setClearValue(clearValue);
+        if (m_colorTarget != m_backbuffer) {
+            colorAttachment
+                .setResolveImageView(colorAttachment.imageView)
+                .setResolveImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+                .setResolveMode(vk::ResolveModeFlagBits::eAverage)
+                .setImageView(m_renderGraph.getImageView(m_colorTarget))
+                .setStoreOp(vk::AttachmentStoreOp::eDontCare);
+        }
+        auto depthAttachment = vk::RenderingAttachmentInfo()
+            .setImageView(m_renderGraph.getImageView(m_depthTarget))
+            .setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+            .setLoadOp(vk::AttachmentLoadOp::eClear)
+            .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+            .setClearValue(depthClearValue);
+        commandBuffer.beginRendering(
+            vk::RenderingInfo()
+                .setRenderArea(m_scissor)
+                .setLayerCount(1)
+                .setPColorAttachments(&colorAttachment)
+                .setColorAttachmentCount(1)
+                .setPDepthAttachment(&depthAttachment),
+            m_dispatch
+        );
+        return;
+    }
+
+    // Start the render pass on the acquired image's framebuffer, the clear values match the attachment indices
+    const vk::ClearValue clearValues[] = { clearValue, depthClearValue };
+    commandBuffer.beginRenderPass(
         vk::RenderPassBeginInfo()
             .setRenderPass(*m_renderPass)
-            .setFramebuffer(*m_framebuffers[imageIndex])
+            .setFramebuffer(m_renderGraph.getFramebuffer(m_backbuffer))
             .setRenderArea(m_scissor)
-            .setPClearValues(&clearValue)
-            .setClearValueCount(1),
+            .setPClearValues(clearValues)
+            .setClearValueCount(2),
         vk::SubpassContents::eInline
     );
+}
 
-    // Bind the graphics pipeline
-    m_commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *m_graphicsPipeline);
-
-    // Set viewport and scissor
-    m_commandBuffer->setViewport(0, 1, &m_viewport);
-    m_commandBuffer->setScissor(0, 1, &m_scissor);
-
-    // Draw the triangle
-    m_commandBuffer->bindVertexBuffers(0, {*m_vertexBuffer}, {0});
-    m_commandBuffer->draw(k_vertexData.size(), 1, 0, 0);
-
-    // End the render pass and recording
-    m_commandBuffer->endRenderPass();
-    m_commandBuffer->end();
+void Graphics::endMainRendering(vk::CommandBuffer commandBuffer) {
+    if (m_dynamicRendering)
+        commandBuffer.endRendering(m_dispatch);
+    else
+        commandBuffer.endRenderPass();
 }
 
 uint32_t Graphics::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags flags) {
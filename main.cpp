@@ -3,6 +3,5 @@
 int main() {
     Application application;
 
-    application.runUntilClose();
-    return 0;
+    return application.runUntilClose();
 }
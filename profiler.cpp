@@ -0,0 +1,365 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+// Pipeline statistics collected for each frame, matching the layout of `PipelineStatistics`
+static const auto k_statisticFlags =
+    vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices |
+    vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+    vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+    vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
+    vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+    vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+static constexpr uint32_t k_statisticCount = sizeof(PipelineStatistics) / sizeof(uint64_t);
+
+void ScopeStatistics::addSample(double milliseconds) {
+    samples[nextSample] = milliseconds;
+    nextSample = (nextSample + 1) % k_windowSize;
+    sampleCount = std::min(sampleCount + 1, k_windowSize);
+    totalCount++;
+}
+
+double ScopeStatistics::average() const {
+    if (sampleCount == 0)
+        return 0.0;
+    double sum = 0.0;
+    for (size_t index = 0; index < sampleCount; index++)
+        sum += samples[index];
+    return sum / static_cast<double>(sampleCount);
+}
+
+double ScopeStatistics::minimum() const {
+    if (sampleCount == 0)
+        return 0.0;
+    return *std::min_element(samples.begin(), samples.begin() + sampleCount);
+}
+
+double ScopeStatistics::maximum() const {
+    if (sampleCount == 0)
+        return 0.0;
+    return *std::max_element(samples.begin(), samples.begin() + sampleCount);
+}
+
+Profiler::Profiler():
+    m_epoch(Clock::now()),
+#ifdef ENABLE_VALIDATION
+    m_dispatch(nullptr),
+#endif
+    m_timestampPeriod(0.0),
+    m_timestampMask(0),
+    m_statisticsEnabled(false),
+    m_currentSlot(0),
+    m_recording(false),
+    m_lastPipelineStatistics(),
+    m_traceEnabled(false),
+    m_droppedTraceEvents(0),
+    m_renderedFrames(0),
+    m_idleWakeups(0)
+{
+}
+
+void Profiler::createQueryPools(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex,
+                                bool statisticsEnabled)
+{
+    m_device = device;
+    m_statisticsEnabled = statisticsEnabled;
+
+    // Timestamps are only usable if the queue family reports valid bits for them
+    auto validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+    m_timestampPeriod = static_cast<double>(physicalDevice.getProperties().limits.timestampPeriod);
+    m_timestampMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+
+    // Create one set of query pools per frame slot so that results are read back only after the slot's frame completed
+    for (auto &slot : m_frameSlots) {
+        if (validBits != 0) {
+            slot.timestampPool = device.createQueryPoolUnique(
+                vk::QueryPoolCreateInfo()
+                    .setQueryType(vk::QueryType::eTimestamp)
+                    .setQueryCount(2 * k_maxGpuScopes)
+            );
+        }
+        if (m_statisticsEnabled) {
+            slot.statisticsPool = device.createQueryPoolUnique(
+                vk::QueryPoolCreateInfo()
+                    .setQueryType(vk::QueryType::ePipelineStatistics)
+                    .setPipelineStatistics(k_statisticFlags)
+                    .setQueryCount(1)
+            );
+        }
+        slot.scopes.reserve(k_maxGpuScopes);
+    }
+}
+
+#ifdef ENABLE_VALIDATION
+void Profiler::setDebugDispatch(const vk::DispatchLoaderDynamic *dispatch) {
+    m_dispatch = dispatch;
+}
+#endif
+
+void Profiler::beginFrame(vk::CommandBuffer commandBuffer) {
+    m_renderedFrames++;
+    if (!m_device)
+        return;
+
+    // Advance to the next slot and collect its results, its frame has been waited for by the frame fence
+    m_currentSlot = (m_currentSlot + 1) % k_frameSlots;
+    auto &slot = m_frameSlots[m_currentSlot];
+    resolveSlot(slot);
+
+    // Reset the slot's queries, this has to happen outside of a render pass
+    if (slot.timestampPool)
+        commandBuffer.resetQueryPool(*slot.timestampPool, 0, 2 * k_maxGpuScopes);
+    if (slot.statisticsPool) {
+        commandBuffer.resetQueryPool(*slot.statisticsPool, 0, 1);
+        commandBuffer.beginQuery(*slot.statisticsPool, 0, vk::QueryControlFlags());
+    }
+
+    // Start the frame scope which serves as the time base for all other GPU scopes
+    slot.scopes.clear();
+    slot.cpuBegin = Clock::now();
+    m_recording = true;
+    slot.frameScope = beginGpuScope(commandBuffer, "frame");
+}
+
+void Profiler::endFrame(vk::CommandBuffer commandBuffer) {
+    if (!m_recording)
+        return;
+
+    auto &slot = m_frameSlots[m_currentSlot];
+    endGpuScope(commandBuffer, slot.frameScope);
+    if (slot.statisticsPool)
+        commandBuffer.endQuery(*slot.statisticsPool, 0);
+    slot.pending = true;
+    m_recording = false;
+}
+
+void Profiler::addIdleWakeup() {
+    m_idleWakeups++;
+}
+
+void Profiler::setTraceEnabled(bool enabled) {
+    m_traceEnabled = enabled;
+}
+
+// Writes a string literal for JSON, escaping quotes and backslashes
+static void writeJsonString(std::ostream &stream, const char *string) {
+    stream << '"';
+    for (; *string != '\0'; string++) {
+        if (*string == '"' || *string == '\\')
+            stream << '\\';
+        stream << *string;
+    }
+    stream << '"';
+}
+
+void Profiler::writeChromeTrace(std::ostream &stream) const {
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // Name the CPU and GPU tracks
+    stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+    // Emit each scope as a complete event
+    for (auto &event : m_traceEvents) {
+        stream << ",\n{\"name\":";
+        writeJsonString(stream, event.name);
+        stream << ",\"cat\":\"" << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\""
+               << ",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs
+               << ",\"pid\":1,\"tid\":" << (event.gpu ? 2 : 1) << "}";
+    }
+
+    // Emit the pipeline statistics as counters
+    for (auto &counter : m_traceCounters) {
+        auto &statistics = counter.second;
+        stream << ",\n{\"name\":\"pipeline statistics\",\"ph\":\"C\",\"ts\":" << counter.first
+               << ",\"pid\":1,\"args\":{"
+               << "\"vertices\":" << statistics.inputVertices
+               << ",\"primitives\":" << statistics.inputPrimitives
+               << ",\"vertexInvocations\":" << statistics.vertexInvocations
+               << ",\"clippingInvocations\":" << statistics.clippingInvocations
+               << ",\"clippingPrimitives\":" << statistics.clippingPrimitives
+               << ",\"fragmentInvocations\":" << statistics.fragmentInvocations << "}}";
+    }
+
+    stream << "\n],\"otherData\":{\"droppedEvents\":" << m_droppedTraceEvents
+           << ",\"renderedFrames\":" << m_renderedFrames
+           << ",\"idleWakeups\":" << m_idleWakeups << "}}\n";
+}
+
+void Profiler::writeStatisticsTable(std::ostream &stream) const {
+    stream << std::fixed << std::setprecision(3);
+    stream << std::left << std::setw(24) << "scope" << std::right
+           << std::setw(10) << "count"
+           << std::setw(12) << "avg ms"
+           << std::setw(12) << "min ms"
+           << std::setw(12) << "max ms" << '\n';
+
+    auto writeRows = [&stream](const char *track, const StatisticsMap &statistics) {
+        for (auto &entry : statistics) {
+            stream << std::left << std::setw(24) << (std::string(track) + ":" + entry.first) << std::right
+                   << std::setw(10) << entry.second.totalCount
+                   << std::setw(12) << entry.second.average()
+                   << std::setw(12) << entry.second.minimum()
+                   << std::setw(12) << entry.second.maximum() << '\n';
+        }
+    };
+    writeRows("cpu", m_cpuStatistics);
+    writeRows("gpu", m_gpuStatistics);
+
+    stream << "frames: " << m_renderedFrames << " rendered, " << m_idleWakeups << " idle wake-ups\n";
+
+    if (m_statisticsEnabled) {
+        auto &statistics = m_lastPipelineStatistics;
+        stream << "last frame: "
+               << statistics.inputVertices << " vertices, "
+               << statistics.inputPrimitives << " primitives, "
+               << statistics.vertexInvocations << " vertex invocations, "
+               << statistics.clippingPrimitives << "/" << statistics.clippingInvocations << " primitives clipped, "
+               << statistics.fragmentInvocations << " fragment invocations\n";
+    }
+}
+
+void Profiler::endCpuScope(const char *name, Clock::time_point begin, Clock::time_point end) {
+    auto milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+
+    auto iterator = m_cpuStatistics.find(std::string_view(name));
+    if (iterator == m_cpuStatistics.end())
+        iterator = m_cpuStatistics.emplace(name, ScopeStatistics()).first;
+    iterator->second.addSample(milliseconds);
+
+    if (m_traceEnabled)
+        addTraceEvent(name, false, toMicroseconds(begin), milliseconds * 1000.0);
+}
+
+uint32_t Profiler::beginGpuScope(vk::CommandBuffer commandBuffer, const char *name) {
+#ifdef ENABLE_VALIDATION
+    // Optionally label the region for debugging tools
+    if (m_dispatch)
+        commandBuffer.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT().setPLabelName(name), *m_dispatch);
+#endif
+
+    // Allocate a pair of timestamp queries if the frame has any left
+    if (!m_recording)
+        return k_invalidScope;
+    auto &slot = m_frameSlots[m_currentSlot];
+    if (!slot.timestampPool || slot.scopes.size() >= k_maxGpuScopes)
+        return k_invalidScope;
+    auto scope = static_cast<uint32_t>(slot.scopes.size());
+    slot.scopes.push_back(GpuScope { name });
+
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *slot.timestampPool, 2 * scope);
+    return scope;
+}
+
+void Profiler::endGpuScope(vk::CommandBuffer commandBuffer, uint32_t scope) {
+    if (scope != k_invalidScope && m_recording) {
+        auto &slot = m_frameSlots[m_currentSlot];
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *slot.timestampPool, 2 * scope + 1);
+    }
+
+#ifdef ENABLE_VALIDATION
+    if (m_dispatch)
+        commandBuffer.endDebugUtilsLabelEXT(*m_dispatch);
+#endif
+}
+
+void Profiler::resolveSlot(FrameSlot &slot) {
+    if (!slot.pending)
+        return;
+    slot.pending = false;
+
+    const auto flags = vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability;
+
+    if (slot.timestampPool && !slot.scopes.empty()) {
+        // Read every timestamp followed by its availability word without waiting, unavailable ones are skipped
+        auto queryCount = static_cast<uint32_t>(2 * slot.scopes.size());
+        std::vector<uint64_t> results(2 * queryCount);
+        vk::resultCheck(
+            m_device.getQueryPoolResults(*slot.timestampPool, 0, queryCount, results.size() * sizeof(uint64_t),
+                                         results.data(), 2 * sizeof(uint64_t), flags),
+            "vk::Device::getQueryPoolResults",
+            { vk::Result::eSuccess, vk::Result::eNotReady }
+        );
+
+        // Place GPU scopes on the CPU timeline relative to the frame's recording time, this is an approximation as
+        // the clocks are not calibrated against each other
+        auto frameBegin = results[0], frameBeginAvailable = results[1];
+        auto frameBeginUs = toMicroseconds(slot.cpuBegin);
+        for (size_t scope = 0; frameBeginAvailable != 0 && scope < slot.scopes.size(); scope++) {
+            auto begin = results[4 * scope], beginAvailable = results[4 * scope + 1];
+            auto end = results[4 * scope + 2], endAvailable = results[4 * scope + 3];
+            if (beginAvailable == 0 || endAvailable == 0)
+                continue;
+
+            auto durationNs = static_cast<double>((end - begin) & m_timestampMask) * m_timestampPeriod;
+            auto offsetNs = static_cast<double>((begin - frameBegin) & m_timestampMask) * m_timestampPeriod;
+            auto name = slot.scopes[scope].name;
+
+            auto iterator = m_gpuStatistics.find(std::string_view(name));
+            if (iterator == m_gpuStatistics.end())
+                iterator = m_gpuStatistics.emplace(name, ScopeStatistics()).first;
+            iterator->second.addSample(durationNs / 1.0e6);
+
+            if (m_traceEnabled)
+                addTraceEvent(name, true, frameBeginUs + offsetNs / 1.0e3, durationNs / 1.0e3);
+        }
+    }
+
+    if (slot.statisticsPool) {
+        // Read the frame's counters followed by their availability word
+        std::array<uint64_t, k_statisticCount + 1> results = {};
+        vk::resultCheck(
+            m_device.getQueryPoolResults(*slot.statisticsPool, 0, 1, sizeof(results), results.data(),
+                                         sizeof(results), flags),
+            "vk::Device::getQueryPoolResults",
+            { vk::Result::eSuccess, vk::Result::eNotReady }
+        );
+        if (results[k_statisticCount] != 0) {
+            m_lastPipelineStatistics = PipelineStatistics {
+                results[0], results[1], results[2], results[3], results[4], results[5]
+            };
+            if (m_traceEnabled && m_traceCounters.size() < k_maxTraceEvents)
+                m_traceCounters.emplace_back(toMicroseconds(slot.cpuBegin), m_lastPipelineStatistics);
+        }
+    }
+}
+
+void Profiler::addTraceEvent(const char *name, bool gpu, double beginUs, double durationUs) {
+    // Keep memory usage bounded during long captures
+    if (m_traceEvents.size() >= k_maxTraceEvents) {
+        m_droppedTraceEvents++;
+        return;
+    }
+    m_traceEvents.push_back(TraceEvent { name, gpu, beginUs, durationUs });
+}
+
+double Profiler::toMicroseconds(Clock::time_point time) const {
+    return std::chrono::duration<double, std::micro>(time - m_epoch).count();
+}
+
+ProfileScope::ProfileScope(Profiler &profiler, const char *name):
+    m_profiler(profiler),
+    m_name(name),
+    m_commandBuffer(),
+    m_begin(Profiler::Clock::now()),
+    m_gpuScope(Profiler::k_invalidScope)
+{
+}
+
+ProfileScope::ProfileScope(Profiler &profiler, vk::CommandBuffer commandBuffer, const char *name):
+    m_profiler(profiler),
+    m_name(name),
+    m_commandBuffer(commandBuffer),
+    m_begin(),
+    m_gpuScope(profiler.beginGpuScope(commandBuffer, name))
+{
+}
+
+ProfileScope::~ProfileScope() {
+    if (m_commandBuffer)
+        m_profiler.endGpuScope(m_commandBuffer, m_gpuScope);
+    else
+        m_profiler.endCpuScope(m_name, m_begin, Profiler::Clock::now());
+}
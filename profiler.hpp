@@ -0,0 +1,144 @@
+#pragma once
+
+#include "pch.hpp"
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Rolling duration statistics of a single named scope over the last `k_windowSize` samples
+struct ScopeStatistics {
+    static constexpr size_t k_windowSize = 120;
+
+    std::array<double, k_windowSize> samples = {};
+    size_t                           sampleCount = 0;
+    size_t                           nextSample = 0;
+    uint64_t                         totalCount = 0;
+
+    void addSample(double milliseconds);
+    double average() const;
+    double minimum() const;
+    double maximum() const;
+};
+
+// Counters of a pipeline statistics query, in the bit order of `vk::QueryPipelineStatisticFlagBits`
+struct PipelineStatistics {
+    uint64_t inputVertices;
+    uint64_t inputPrimitives;
+    uint64_t vertexInvocations;
+    uint64_t clippingInvocations;
+    uint64_t clippingPrimitives;
+    uint64_t fragmentInvocations;
+};
+
+// Collects CPU and GPU scope timings, keeps rolling statistics and optionally records a Chrome trace;
+// it is not thread-safe and meant to be used from the render loop only
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Profiler();
+
+    // GPU setup, called once the logical device exists
+    void createQueryPools(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex,
+                          bool statisticsEnabled);
+#ifdef ENABLE_VALIDATION
+    void setDebugDispatch(const vk::DispatchLoaderDynamic *dispatch);
+#endif
+
+    // Frame boundaries within a recording command buffer
+    void beginFrame(vk::CommandBuffer commandBuffer);
+    void endFrame(vk::CommandBuffer commandBuffer);
+
+    // Wake-ups of the render loop (timeouts, input events) which did not render a frame
+    void addIdleWakeup();
+
+    // Result export
+    void setTraceEnabled(bool enabled);
+    void writeChromeTrace(std::ostream &stream) const;
+    void writeStatisticsTable(std::ostream &stream) const;
+private:
+    friend class ProfileScope;
+
+    // Each GPU scope uses two consecutive timestamp queries, slot 0 is reserved for the whole frame
+    static constexpr uint32_t k_maxGpuScopes = 32;
+    static constexpr uint32_t k_frameSlots = 2;
+    static constexpr size_t   k_maxTraceEvents = 1 << 20;
+    static constexpr uint32_t k_invalidScope = UINT32_MAX;
+
+    struct GpuScope {
+        const char *name;
+    };
+
+    struct FrameSlot {
+        vk::UniqueQueryPool   timestampPool;
+        vk::UniqueQueryPool   statisticsPool;
+        std::vector<GpuScope> scopes;
+        uint32_t              frameScope = k_invalidScope;
+        Clock::time_point     cpuBegin;
+        bool                  pending = false;
+    };
+
+    struct TraceEvent {
+        const char *name;
+        bool        gpu;
+        double      beginUs;
+        double      durationUs;
+    };
+
+    using TraceCounter = std::pair<double, PipelineStatistics>;
+    using StatisticsMap = std::map<std::string, ScopeStatistics, std::less<>>;
+
+    Clock::time_point                   m_epoch;
+    vk::Device                          m_device;
+#ifdef ENABLE_VALIDATION
+    const vk::DispatchLoaderDynamic    *m_dispatch;
+#endif
+    double                              m_timestampPeriod;
+    uint64_t                            m_timestampMask;
+    bool                                m_statisticsEnabled;
+    std::array<FrameSlot, k_frameSlots> m_frameSlots;
+    uint32_t                            m_currentSlot;
+    bool                                m_recording;
+    StatisticsMap                       m_cpuStatistics;
+    StatisticsMap                       m_gpuStatistics;
+    PipelineStatistics                  m_lastPipelineStatistics;
+    bool                                m_traceEnabled;
+    std::vector<TraceEvent>             m_traceEvents;
+    std::vector<TraceCounter>           m_traceCounters;
+    size_t                              m_droppedTraceEvents;
+    uint64_t                            m_renderedFrames;
+    uint64_t                            m_idleWakeups;
+
+    // Scope bookkeeping used by `ProfileScope`
+    void endCpuScope(const char *name, Clock::time_point begin, Clock::time_point end);
+    uint32_t beginGpuScope(vk::CommandBuffer commandBuffer, const char *name);
+    void endGpuScope(vk::CommandBuffer commandBuffer, uint32_t scope);
+
+    // Non-blocking readback of a slot's queries once its frame has completed
+    void resolveSlot(FrameSlot &slot);
+    void addTraceEvent(const char *name, bool gpu, double beginUs, double durationUs);
+    double toMicroseconds(Clock::time_point time) const;
+};
+
+// Measures the lifetime of the scope on the CPU, or on the GPU when given a command buffer;
+// `name` must outlive the profiler (usually a string literal)
+class ProfileScope {
+public:
+    ProfileScope(Profiler &profiler, const char *name);
+    ProfileScope(Profiler &profiler, vk::CommandBuffer commandBuffer, const char *name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+private:
+    Profiler                   &m_profiler;
+    const char                 *m_name;
+    vk::CommandBuffer           m_commandBuffer;
+    Profiler::Clock::time_point m_begin;
+    uint32_t                    m_gpuScope;
+};
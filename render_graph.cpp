@@ -0,0 +1,490 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Access bits which represent writes and therefore have to be made available by barriers
+static const auto k_writeAccess =
+    vk::AccessFlagBits::eColorAttachmentWrite |
+    vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits::eShaderWrite |
+    vk::AccessFlagBits::eTransferWrite |
+    vk::AccessFlagBits::eHostWrite |
+    vk::AccessFlagBits::eMemoryWrite;
+
+// Layout, stages and access flags which are required by a usage
+struct UsageState {
+    vk::ImageLayout        layout;
+    vk::PipelineStageFlags stages;
+    vk::AccessFlags        access;
+};
+
+static UsageState getUsageState(ResourceUsage usage, bool write) {
+    const auto fragmentTests = vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                               vk::PipelineStageFlagBits::eLateFragmentTests;
+    switch (usage) {
+        case ResourceUsage::eColorAttachment:
+            return {
+                vk::ImageLayout::eColorAttachmentOptimal,
+                vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                write ? vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+                      : vk::AccessFlags(vk::AccessFlagBits::eColorAttachmentRead)
+            };
+        case ResourceUsage::eDepthAttachment:
+            return {
+                vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                fragmentTests,
+                write ? vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                        vk::AccessFlagBits::eDepthStencilAttachmentWrite
+                      : vk::AccessFlags(vk::AccessFlagBits::eDepthStencilAttachmentRead)
+            };
+        case ResourceUsage::eDepthReadOnly:
+            return {
+                vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                fragmentTests,
+                vk::AccessFlagBits::eDepthStencilAttachmentRead
+            };
+        case ResourceUsage::eSampled:
+            return {
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                vk::PipelineStageFlagBits::eFragmentShader,
+                vk::AccessFlagBits::eShaderRead
+            };
+        case ResourceUsage::eTransferSrc:
+            return {
+                vk::ImageLayout::eTransferSrcOptimal,
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::AccessFlagBits::eTransferRead
+            };
+        case ResourceUsage::eTransferDst:
+            return {
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::AccessFlagBits::eTransferWrite
+            };
+    }
+    throw std::runtime_error("Unknown render graph resource usage");
+}
+
+// Finds a memory type which has all of the given property flags, returns `UINT32_MAX` if there is none
+static uint32_t findMemoryTypeWithFlags(const vk::PhysicalDeviceMemoryProperties &memoryProperties,
+                                        uint32_t typeFilter, vk::MemoryPropertyFlags flags)
+{
+    for (uint32_t index = 0; index < memoryProperties.memoryTypeCount; index++) {
+        if (typeFilter & (1 << index) && (memoryProperties.memoryTypes[index].propertyFlags & flags) == flags)
+            return index;
+    }
+    return UINT32_MAX;
+}
+
+void RenderGraph::clear() {
+    // Destroy the transient images before their memory and forget all declarations
+    m_resources.clear();
+    m_memoryBlocks.clear();
+    m_passes.clear();
+    m_schedule.clear();
+    m_passBarriers.clear();
+    m_finalBarriers = BarrierBatch();
+}
+
+RenderGraph::ResourceId RenderGraph::importImage(const char *name, vk::ImageAspectFlags aspect,
+                                                 vk::PipelineStageFlags readyStages, vk::ImageLayout finalLayout)
+{
+    auto resource = Resource();
+    resource.name = name;
+    resource.imported = true;
+    resource.aspect = aspect;
+    resource.readyStages = readyStages;
+    resource.finalLayout = finalLayout;
+    m_resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::createTransientImage(const char *name, const TransientImageInfo &info) {
+    auto resource = Resource();
+    resource.name = name;
+    resource.imported = false;
+    resource.aspect = info.aspect;
+    resource.finalLayout = vk::ImageLayout::eUndefined;
+    resource.info = info;
+    m_resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::addPass(const char *name, RecordFunction record) {
+    m_passes.push_back(Pass { name, std::move(record), {}, false, false });
+    return static_cast<PassId>(m_passes.size() - 1);
+}
+
+void RenderGraph::addRead(PassId pass, ResourceId resource, ResourceUsage usage) {
+    addAccess(pass, resource, usage, false);
+}
+
+void RenderGraph::addWrite(PassId pass, ResourceId resource, ResourceUsage usage) {
+    addAccess(pass, resource, usage, true);
+}
+
+void RenderGraph::setSideEffect(PassId pass) {
+    // Passes with effects outside of the graph (e.g. copies into buffers) are never culled
+    m_passes[pass].sideEffect = true;
+}
+
+void RenderGraph::compile(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties,
+                          vk::Extent2D extent)
+{
+    cullPasses();
+    computeLifetimes();
+    allocateTransients(device, memoryProperties, extent);
+    computeBarriers();
+}
+
+void RenderGraph::setImportedImage(ResourceId resource, vk::Image image, vk::ImageView view,
+                                   vk::Framebuffer framebuffer)
+{
+    // The framebuffer is optional, it is only used by passes which render into the image with a render pass
+    m_resources[resource].image = image;
+    m_resources[resource].view = view;
+    m_resources[resource].framebuffer = framebuffer;
+}
+
+vk::Image RenderGraph::getImage(ResourceId resource) const {
+    return m_resources[resource].image;
+}
+
+vk::ImageView RenderGraph::getImageView(ResourceId resource) const {
+    return m_resources[resource].view;
+}
+
+vk::Framebuffer RenderGraph::getFramebuffer(ResourceId resource) const {
+    return m_resources[resource].framebuffer;
+}
+
+void RenderGraph::execute(vk::CommandBuffer commandBuffer, Profiler &profiler) {
+    for (size_t index = 0; index < m_schedule.size(); index++) {
+        auto &pass = m_passes[m_schedule[index]];
+
+        // Measure each pass on the GPU including the barriers it has to wait for
+        ProfileScope scope(profiler, commandBuffer, pass.name);
+        recordBarriers(commandBuffer, m_passBarriers[index]);
+        pass.record(commandBuffer);
+    }
+
+    // Transition imported images to the layouts expected after the graph
+    recordBarriers(commandBuffer, m_finalBarriers);
+}
+
+void RenderGraph::cullPasses() {
+    // Imported images are the graph's outputs, everything else is only needed if a live pass reads it
+    auto needed = std::vector<bool>(m_resources.size());
+    for (size_t index = 0; index < m_resources.size(); index++)
+        needed[index] = m_resources[index].imported;
+
+    // Walk backwards so that a pass is known to be live before the passes producing its inputs are visited
+    for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); pass++) {
+        pass->live = pass->sideEffect || std::any_of(pass->accesses.begin(), pass->accesses.end(),
+            [&needed](const Access &access) { return access.write && needed[access.resource]; });
+        if (!pass->live)
+            continue;
+        for (auto &access : pass->accesses) {
+            if (!access.write)
+                needed[access.resource] = true;
+        }
+    }
+
+    // Schedule the live passes in declaration order
+    m_schedule.clear();
+    for (PassId pass = 0; pass < m_passes.size(); pass++) {
+        if (m_passes[pass].live)
+            m_schedule.push_back(pass);
+    }
+}
+
+void RenderGraph::computeLifetimes() {
+    // Lifetimes are expressed as the first and last index into the schedule
+    for (auto &resource : m_resources) {
+        resource.firstPass = k_unused;
+        resource.lastPass = k_unused;
+    }
+    for (uint32_t index = 0; index < m_schedule.size(); index++) {
+        for (auto &access : m_passes[m_schedule[index]].accesses) {
+            auto &resource = m_resources[access.resource];
+            if (resource.firstPass == k_unused)
+                resource.firstPass = index;
+            resource.lastPass = index;
+        }
+    }
+}
+
+void RenderGraph::allocateTransients(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties,
+                                     vk::Extent2D extent)
+{
+    struct MemoryBlock {
+        vk::MemoryRequirements  requirements;
+        bool                    lazy;
+        std::vector<ResourceId> members;
+    };
+
+    // Destroy the images of a previous compilation before their memory
+    for (auto &resource : m_resources) {
+        if (resource.imported)
+            continue;
+        resource.view = vk::ImageView();
+        resource.ownedView.reset();
+        resource.ownedImage.reset();
+        resource.image = vk::Image();
+    }
+    m_memoryBlocks.clear();
+
+    // Create an image for each transient which is used by a live pass
+    auto transients = std::vector<ResourceId>();
+    auto requirements = std::vector<vk::MemoryRequirements>(m_resources.size());
+    for (ResourceId id = 0; id < m_resources.size(); id++) {
+        auto &resource = m_resources[id];
+        if (resource.imported || resource.firstPass == k_unused)
+            continue;
+
+        resource.ownedImage = device.createImageUnique(
+            vk::ImageCreateInfo()
+                .setImageType(vk::ImageType::e2D)
+                .setFormat(resource.info.format)
+                .setExtent(vk::Extent3D(extent.width, extent.height, 1))
+                .setMipLevels(1)
+                .setArrayLayers(1)
+                .setSamples(resource.info.samples)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setUsage(resource.info.usage)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+        );
+        resource.image = *resource.ownedImage;
+        requirements[id] = device.getImageMemoryRequirements(resource.image);
+        transients.push_back(id);
+    }
+
+    // Place the largest images first, each into the first block whose members' lifetimes do not overlap with it
+    std::sort(transients.begin(), transients.end(), [&requirements](ResourceId left, ResourceId right) {
+        return requirements[left].size > requirements[right].size;
+    });
+    auto blocks = std::vector<MemoryBlock>();
+    for (auto id : transients) {
+        auto &resource = m_resources[id];
+        auto lazy = static_cast<bool>(resource.info.usage & vk::ImageUsageFlagBits::eTransientAttachment);
+        auto fits = [&](const MemoryBlock &block) {
+            if (block.lazy != lazy || !(block.requirements.memoryTypeBits & requirements[id].memoryTypeBits))
+                return false;
+            return std::none_of(block.members.begin(), block.members.end(), [&](ResourceId other) {
+                auto &member = m_resources[other];
+                return resource.firstPass <= member.lastPass && member.firstPass <= resource.lastPass;
+            });
+        };
+
+        auto block = std::find_if(blocks.begin(), blocks.end(), fits);
+        if (block == blocks.end()) {
+            blocks.push_back(MemoryBlock { requirements[id], lazy, { id } });
+            continue;
+        }
+        block->requirements.size = std::max(block->requirements.size, requirements[id].size);
+        block->requirements.alignment = std::max(block->requirements.alignment, requirements[id].alignment);
+        block->requirements.memoryTypeBits &= requirements[id].memoryTypeBits;
+        block->members.push_back(id);
+    }
+
+    for (auto &block : blocks) {
+        // Prefer lazily allocated memory for transient attachments so that tilers never have to back them
+        auto typeIndex = UINT32_MAX;
+        if (block.lazy) {
+            typeIndex = findMemoryTypeWithFlags(memoryProperties, block.requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated);
+        }
+        if (typeIndex == UINT32_MAX) {
+            typeIndex = findMemoryTypeWithFlags(memoryProperties, block.requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal);
+        }
+        if (typeIndex == UINT32_MAX)
+            throw std::runtime_error("Unable to find memory type for transient images");
+
+        // Allocate the block and bind all of its members to its start
+        m_memoryBlocks.push_back(device.allocateMemoryUnique(
+            vk::MemoryAllocateInfo()
+                .setAllocationSize(block.requirements.size)
+                .setMemoryTypeIndex(typeIndex)
+        ));
+        for (auto id : block.members)
+            device.bindImageMemory(m_resources[id].image, *m_memoryBlocks.back(), 0);
+
+        // Each member takes over the memory from the member used before it, the first one from the last member of
+        // the previous frame
+        std::sort(block.members.begin(), block.members.end(), [this](ResourceId left, ResourceId right) {
+            return m_resources[left].firstPass < m_resources[right].firstPass;
+        });
+        for (size_t index = 0; index < block.members.size(); index++) {
+            auto predecessor = (index + block.members.size() - 1) % block.members.size();
+            m_resources[block.members[index]].aliasPredecessor = block.members[predecessor];
+        }
+    }
+
+    // Create a view for each transient image
+    for (auto id : transients) {
+        auto &resource = m_resources[id];
+        resource.ownedView = device.createImageViewUnique(
+            vk::ImageViewCreateInfo()
+                .setImage(resource.image)
+                .setViewType(vk::ImageViewType::e2D)
+                .setFormat(resource.info.format)
+                .setSubresourceRange(
+                    vk::ImageSubresourceRange()
+                        .setAspectMask(resource.aspect)
+                        .setBaseMipLevel(0)
+                        .setLevelCount(1)
+                        .setBaseArrayLayer(0)
+                        .setLayerCount(1)
+                )
+        );
+        resource.view = *resource.ownedView;
+    }
+}
+
+void RenderGraph::computeBarriers() {
+    auto states = std::vector<ResourceState>(m_resources.size());
+    for (size_t index = 0; index < m_resources.size(); index++) {
+        if (m_resources[index].firstPass != k_unused)
+            states[index] = getInitialState(m_resources[index]);
+    }
+
+    // Simulate the schedule and collect the barriers each pass needs into a single batch
+    m_passBarriers.assign(m_schedule.size(), BarrierBatch());
+    for (size_t index = 0; index < m_schedule.size(); index++) {
+        auto &batch = m_passBarriers[index];
+        for (auto &access : m_passes[m_schedule[index]].accesses) {
+            auto &state = states[access.resource];
+            auto usage = getUsageState(access.usage, access.write);
+            auto layoutChange = usage.layout != state.layout;
+            auto previousStages = state.writeStages | state.readStages;
+
+            if (layoutChange || access.write) {
+                // Transitions and writes have to wait for all previous accesses, writes among them made available
+                if (layoutChange || previousStages) {
+                    batch.srcStages |= previousStages;
+                    batch.dstStages |= usage.stages;
+                    batch.barriers.push_back(ImageBarrier {
+                        access.resource, state.layout, usage.layout, state.writeAccess, usage.access
+                    });
+                }
+                state.layout = usage.layout;
+                if (access.write) {
+                    state.writeStages = usage.stages;
+                    state.writeAccess = usage.access & k_writeAccess;
+                    state.readStages = vk::PipelineStageFlags();
+                    state.visibleStages = vk::PipelineStageFlags();
+                } else {
+                    state.readStages |= usage.stages;
+                    state.visibleStages = usage.stages;
+                }
+            } else {
+                // Reads in the current layout only have to wait for a previous write not yet visible to them
+                if (state.writeAccess && (state.visibleStages & usage.stages) != usage.stages) {
+                    batch.srcStages |= state.writeStages;
+                    batch.dstStages |= usage.stages;
+                    batch.barriers.push_back(ImageBarrier {
+                        access.resource, state.layout, state.layout, state.writeAccess, usage.access
+                    });
+                    state.visibleStages |= usage.stages;
+                }
+                state.readStages |= usage.stages;
+            }
+        }
+    }
+
+    // Transition the used imported images to their final layouts
+    m_finalBarriers = BarrierBatch();
+    for (ResourceId id = 0; id < m_resources.size(); id++) {
+        auto &resource = m_resources[id];
+        auto &state = states[id];
+        if (!resource.imported || resource.firstPass == k_unused)
+            continue;
+        if (resource.finalLayout == vk::ImageLayout::eUndefined || resource.finalLayout == state.layout)
+            continue;
+        m_finalBarriers.srcStages |= state.writeStages | state.readStages;
+        m_finalBarriers.dstStages |= vk::PipelineStageFlagBits::eBottomOfPipe;
+        m_finalBarriers.barriers.push_back(ImageBarrier {
+            id, state.layout, resource.finalLayout, state.writeAccess, vk::AccessFlags()
+        });
+    }
+}
+
+RenderGraph::ResourceState RenderGraph::getInitialState(const Resource &resource) const {
+    // Contents are never preserved across frames, so every image starts out undefined
+    auto state = ResourceState();
+    state.layout = vk::ImageLayout::eUndefined;
+
+    // Imported images have to wait for the stages in which they become ready (e.g. after image acquisition)
+    if (resource.imported) {
+        state.writeStages = resource.readyStages;
+        return state;
+    }
+
+    // Transient images have to wait for the last accesses of the image previously occupying their memory
+    auto &predecessor = m_resources[resource.aliasPredecessor];
+    for (auto &access : m_passes[m_schedule[predecessor.lastPass]].accesses) {
+        if (access.resource != resource.aliasPredecessor)
+            continue;
+        auto usage = getUsageState(access.usage, access.write);
+        state.writeStages |= usage.stages;
+        state.writeAccess |= usage.access & k_writeAccess;
+    }
+    return state;
+}
+
+void RenderGraph::addAccess(PassId pass, ResourceId resource, ResourceUsage usage, bool write) {
+    // A pass can only use each image in a single layout
+    auto &accesses = m_passes[pass].accesses;
+    auto duplicate = std::any_of(accesses.begin(), accesses.end(), [resource](const Access &access) {
+        return access.resource == resource;
+    });
+    if (duplicate)
+        throw std::runtime_error("Render graph pass accesses a resource more than once");
+    accesses.push_back(Access { resource, usage, write });
+}
+
+void RenderGraph::recordBarriers(vk::CommandBuffer commandBuffer, const BarrierBatch &batch) {
+    if (batch.barriers.empty())
+        return;
+
+    // Translate the planned barriers using the images of this frame
+    m_barrierScratch.clear();
+    for (auto &barrier : batch.barriers) {
+        auto &resource = m_resources[barrier.resource];
+        m_barrierScratch.push_back(
+            vk::ImageMemoryBarrier()
+                .setImage(resource.image)
+                .setOldLayout(barrier.oldLayout)
+                .setNewLayout(barrier.newLayout)
+                .setSrcAccessMask(barrier.srcAccess)
+                .setDstAccessMask(barrier.dstAccess)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setSubresourceRange(
+                    vk::ImageSubresourceRange()
+                        .setAspectMask(resource.aspect)
+                        .setBaseMipLevel(0)
+                        .setLevelCount(1)
+                        .setBaseArrayLayer(0)
+                        .setLayerCount(1)
+                )
+        );
+    }
+
+    // Record all of them with a single pipeline barrier
+    auto srcStages = batch.srcStages;
+    auto dstStages = batch.dstStages;
+    if (!srcStages)
+        srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+    if (!dstStages)
+        dstStages = vk::PipelineStageFlagBits::eBottomOfPipe;
+    commandBuffer.pipelineBarrier(
+        srcStages, dstStages, vk::DependencyFlags(),
+        0, nullptr,
+        0, nullptr,
+        static_cast<uint32_t>(m_barrierScratch.size()), m_barrierScratch.data()
+    );
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "pch.hpp"
+#include "profiler.hpp"
+
+#include <functional>
+#include <vector>
+
+// Ways in which a pass can access an image
+enum class ResourceUsage {
+    eColorAttachment,
+    eDepthAttachment,
+    eDepthReadOnly,
+    eSampled,
+    eTransferSrc,
+    eTransferDst,
+};
+
+// Description of an image owned by the render graph, its extent is the one given at compilation
+struct TransientImageInfo {
+    vk::Format              format;
+    vk::ImageUsageFlags     usage;
+    vk::ImageAspectFlags    aspect;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+};
+
+// Orders passes by their declared image accesses; compilation culls passes that do not contribute to an imported
+// image, computes batched barriers with layout transitions and aliases the memory of transient images whose
+// lifetimes do not overlap
+class RenderGraph {
+public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+    using RecordFunction = std::function<void(vk::CommandBuffer)>;
+
+    // Declaration, passes execute in the order they were added
+    void clear();
+    ResourceId importImage(const char *name, vk::ImageAspectFlags aspect, vk::PipelineStageFlags readyStages,
+                           vk::ImageLayout finalLayout);
+    ResourceId createTransientImage(const char *name, const TransientImageInfo &info);
+    PassId addPass(const char *name, RecordFunction record);
+    void addRead(PassId pass, ResourceId resource, ResourceUsage usage);
+    void addWrite(PassId pass, ResourceId resource, ResourceUsage usage);
+    void setSideEffect(PassId pass);
+
+    // Compilation, has to be repeated whenever the extent changes
+    void compile(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties, vk::Extent2D extent);
+
+    // Execution
+    void setImportedImage(ResourceId resource, vk::Image image, vk::ImageView view,
+                          vk::Framebuffer framebuffer = vk::Framebuffer());
+    vk::Image getImage(ResourceId resource) const;
+    vk::ImageView getImageView(ResourceId resource) const;
+    vk::Framebuffer getFramebuffer(ResourceId resource) const;
+    void execute(vk::CommandBuffer commandBuffer, Profiler &profiler);
+private:
+    static constexpr uint32_t k_unused = UINT32_MAX;
+
+    struct Access {
+        ResourceId    resource;
+        ResourceUsage usage;
+        bool          write;
+    };
+
+    struct Pass {
+        const char         *name;
+        RecordFunction      record;
+        std::vector<Access> accesses;
+        bool                sideEffect;
+        bool                live;
+    };
+
+    struct Resource {
+        const char            *name;
+        bool                   imported;
+        vk::ImageAspectFlags   aspect;
+        vk::PipelineStageFlags readyStages;
+        vk::ImageLayout        finalLayout;
+        TransientImageInfo     info;
+        vk::Image              image;
+        vk::UniqueImage        ownedImage;
+        vk::ImageView          view;
+        vk::UniqueImageView    ownedView;
+        vk::Framebuffer        framebuffer;
+        uint32_t               firstPass;
+        uint32_t               lastPass;
+        ResourceId             aliasPredecessor;
+    };
+
+    // Synchronization state of an image while simulating the schedule
+    struct ResourceState {
+        vk::ImageLayout        layout;
+        vk::PipelineStageFlags writeStages;
+        vk::AccessFlags        writeAccess;
+        vk::PipelineStageFlags readStages;
+        vk::PipelineStageFlags visibleStages;
+    };
+
+    struct ImageBarrier {
+        ResourceId      resource;
+        vk::ImageLayout oldLayout;
+        vk::ImageLayout newLayout;
+        vk::AccessFlags srcAccess;
+        vk::AccessFlags dstAccess;
+    };
+
+    struct BarrierBatch {
+        vk::PipelineStageFlags    srcStages;
+        vk::PipelineStageFlags    dstStages;
+        std::vector<ImageBarrier> barriers;
+    };
+
+    std::vector<vk::UniqueDeviceMemory> m_memoryBlocks;
+    std::vector<Resource>               m_resources;
+    std::vector<Pass>                   m_passes;
+    std::vector<PassId>                 m_schedule;
+    std::vector<BarrierBatch>           m_passBarriers;
+    BarrierBatch                        m_finalBarriers;
+    std::vector<vk::ImageMemoryBarrier> m_barrierScratch;
+
+    // Compilation steps
+    void cullPasses();
+    void computeLifetimes();
+    void allocateTransients(vk::Device device, const vk::PhysicalDeviceMemoryProperties &memoryProperties,
+                            vk::Extent2D extent);
+    void computeBarriers();
+    ResourceState getInitialState(const Resource &resource) const;
+
+    void addAccess(PassId pass, ResourceId resource, ResourceUsage usage, bool write);
+    void recordBarriers(vk::CommandBuffer commandBuffer, const BarrierBatch &batch);
+};